@@ -45,9 +45,11 @@ fi
 
 source_file="src/main.c"
 output_name="math"
+compiler_flags="-O2 -pthread"
+linker_flags="-lm -lpthread"
 
 # Compile the main C file
-$compiler -o "$output_name" "$source_file"
+$compiler $compiler_flags -o "$output_name" "$source_file" $linker_flags
 
 # Check if the compilation was successful
 if ! command; then
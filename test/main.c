@@ -99,6 +99,111 @@ struct TestCase *create_test_cases(char *program_path)
     test_case_17(test_cases + offset++, program_path);
     test_case_18(test_cases + offset++, program_path);
     test_case_19(test_cases + offset++, program_path);
+    test_case_20(test_cases + offset++, program_path);
+    test_case_21(test_cases + offset++, program_path);
+    test_case_22(test_cases + offset++, program_path);
+    test_case_23(test_cases + offset++, program_path);
+    test_case_24(test_cases + offset++, program_path);
+    test_case_25(test_cases + offset++, program_path);
+    test_case_26(test_cases + offset++, program_path);
+    test_case_27(test_cases + offset++, program_path);
+    test_case_28(test_cases + offset++, program_path);
+    test_case_29(test_cases + offset++, program_path);
+    test_case_30(test_cases + offset++, program_path);
+    test_case_31(test_cases + offset++, program_path);
+    test_case_32(test_cases + offset++, program_path);
+    test_case_33(test_cases + offset++, program_path);
+    test_case_34(test_cases + offset++, program_path);
+    test_case_35(test_cases + offset++, program_path);
+    test_case_36(test_cases + offset++, program_path);
+    test_case_37(test_cases + offset++, program_path);
+    test_case_38(test_cases + offset++, program_path);
+    test_case_39(test_cases + offset++, program_path);
+    test_case_40(test_cases + offset++, program_path);
+    test_case_41(test_cases + offset++, program_path);
+    test_case_42(test_cases + offset++, program_path);
+    test_case_43(test_cases + offset++, program_path);
+    test_case_44(test_cases + offset++, program_path);
+    test_case_45(test_cases + offset++, program_path);
+    test_case_46(test_cases + offset++, program_path);
+    test_case_47(test_cases + offset++, program_path);
+    test_case_48(test_cases + offset++, program_path);
+    test_case_49(test_cases + offset++, program_path);
+    test_case_50(test_cases + offset++, program_path);
+    test_case_51(test_cases + offset++, program_path);
+    test_case_52(test_cases + offset++, program_path);
+    test_case_53(test_cases + offset++, program_path);
+    test_case_54(test_cases + offset++, program_path);
+    test_case_55(test_cases + offset++, program_path);
+    test_case_56(test_cases + offset++, program_path);
+    test_case_57(test_cases + offset++, program_path);
+    test_case_58(test_cases + offset++, program_path);
+    test_case_59(test_cases + offset++, program_path);
+    test_case_60(test_cases + offset++, program_path);
+    test_case_61(test_cases + offset++, program_path);
+    test_case_62(test_cases + offset++, program_path);
+    test_case_63(test_cases + offset++, program_path);
+    test_case_64(test_cases + offset++, program_path);
+    test_case_65(test_cases + offset++, program_path);
+    test_case_66(test_cases + offset++, program_path);
+    test_case_67(test_cases + offset++, program_path);
+    test_case_68(test_cases + offset++, program_path);
+    test_case_69(test_cases + offset++, program_path);
+    test_case_70(test_cases + offset++, program_path);
+    test_case_71(test_cases + offset++, program_path);
+    test_case_72(test_cases + offset++, program_path);
+    test_case_73(test_cases + offset++, program_path);
+    test_case_74(test_cases + offset++, program_path);
+    test_case_75(test_cases + offset++, program_path);
+    test_case_76(test_cases + offset++, program_path);
+    test_case_77(test_cases + offset++, program_path);
+    test_case_78(test_cases + offset++, program_path);
+    test_case_79(test_cases + offset++, program_path);
+    test_case_80(test_cases + offset++, program_path);
+    test_case_81(test_cases + offset++, program_path);
+    test_case_82(test_cases + offset++, program_path);
+    test_case_83(test_cases + offset++, program_path);
+    test_case_84(test_cases + offset++, program_path);
+    test_case_85(test_cases + offset++, program_path);
+    test_case_86(test_cases + offset++, program_path);
+    test_case_87(test_cases + offset++, program_path);
+    test_case_88(test_cases + offset++, program_path);
+    test_case_89(test_cases + offset++, program_path);
+    test_case_90(test_cases + offset++, program_path);
+    test_case_91(test_cases + offset++, program_path);
+    test_case_92(test_cases + offset++, program_path);
+    test_case_93(test_cases + offset++, program_path);
+    test_case_94(test_cases + offset++, program_path);
+    test_case_95(test_cases + offset++, program_path);
+    test_case_96(test_cases + offset++, program_path);
+    test_case_97(test_cases + offset++, program_path);
+    test_case_98(test_cases + offset++, program_path);
+    test_case_99(test_cases + offset++, program_path);
+    test_case_100(test_cases + offset++, program_path);
+    test_case_101(test_cases + offset++, program_path);
+    test_case_102(test_cases + offset++, program_path);
+    test_case_103(test_cases + offset++, program_path);
+    test_case_104(test_cases + offset++, program_path);
+    test_case_105(test_cases + offset++, program_path);
+    test_case_106(test_cases + offset++, program_path);
+    test_case_107(test_cases + offset++, program_path);
+    test_case_108(test_cases + offset++, program_path);
+    test_case_109(test_cases + offset++, program_path);
+    test_case_110(test_cases + offset++, program_path);
+    test_case_111(test_cases + offset++, program_path);
+    test_case_112(test_cases + offset++, program_path);
+    test_case_113(test_cases + offset++, program_path);
+    test_case_114(test_cases + offset++, program_path);
+    test_case_115(test_cases + offset++, program_path);
+    test_case_116(test_cases + offset++, program_path);
+    test_case_117(test_cases + offset++, program_path);
+    test_case_118(test_cases + offset++, program_path);
+    test_case_119(test_cases + offset++, program_path);
+    test_case_120(test_cases + offset++, program_path);
+    test_case_121(test_cases + offset++, program_path);
+    test_case_122(test_cases + offset++, program_path);
+    test_case_123(test_cases + offset++, program_path);
+    test_case_124(test_cases + offset++, program_path);
 
     return test_cases;
 }
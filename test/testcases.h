@@ -3,7 +3,7 @@
 
 #include <stdarg.h>
 
-#define BUF_OUTPUT_SIZE 1024
+#define BUF_OUTPUT_SIZE 8192
 
 /**
  * Stores test parameters. input is argv for the tested program. Expected output can
@@ -18,7 +18,7 @@ struct TestCase
 };
 
 /** The number of test cases. */
-#define NUM_TESTS 19
+#define NUM_TESTS 124
 
 /**
  * Given a list of string arguments, create a argument vector. Prefixes the name of the
@@ -34,22 +34,72 @@ static char **assemble_input(char *program_path, size_t num_args, ...);
 #define COLOR_OFF   "\033[m"
 #define HELP_MSG COLOR_BOLD "\nmath" COLOR_OFF " - command line calculator\n" \
 COLOR_BOLD "\nUSAGE\n" COLOR_OFF \
-COLOR_BOLD "\tmath " COLOR_OFF "<" COLOR_BOLD "expression" COLOR_OFF ">\n" \
+COLOR_BOLD "\tmath " COLOR_OFF "[" COLOR_BOLD "options" COLOR_OFF "] <" COLOR_BOLD "expression" COLOR_OFF ">\n" \
+COLOR_BOLD "\tmath " COLOR_OFF "[" COLOR_BOLD "options" COLOR_OFF "]" COLOR_BOLD " -\n" COLOR_OFF \
+COLOR_BOLD "\nOPTIONS\n" COLOR_OFF \
+COLOR_BOLD "\t--threads " COLOR_OFF "<" COLOR_BOLD "n" COLOR_OFF "> - use n threads for reductions and large expressions (default: one per processor)\n" \
+COLOR_BOLD "\t--columns " COLOR_OFF "<" COLOR_BOLD "file" COLOR_OFF "> - evaluate once per row of a binary column file (" COLOR_BOLD "-" COLOR_OFF " for standard input)\n" \
+COLOR_BOLD "\t--csv " COLOR_OFF "<" COLOR_BOLD "file" COLOR_OFF "> - evaluate once per row of a CSV file (" COLOR_BOLD "-" COLOR_OFF " for standard input)\n" \
+COLOR_BOLD "\t--defs " COLOR_OFF "<" COLOR_BOLD "file" COLOR_OFF "> - load functions defined one per line, eg: def f(x, y) = x^2 + y\n" \
+COLOR_BOLD "\t--decimal " COLOR_OFF "<" COLOR_BOLD "digits" COLOR_OFF "> - exact fixed-point decimals with digits after the point (0 to 18)\n" \
+COLOR_BOLD "\t--rounding " COLOR_OFF "<" COLOR_BOLD "mode" COLOR_OFF "> - half-even (default), half-up, half-down, up, down, ceiling or floor\n" \
+COLOR_BOLD "\t--mod " COLOR_OFF "<" COLOR_BOLD "m" COLOR_OFF "> - compute whole numbers modulo m, with exact exponents\n" \
+COLOR_BOLD "\t--fast-math" COLOR_OFF " - faster pow, exp and log and reassociated sums, to within a few ULP\n" \
+COLOR_BOLD "\t--emit-c " COLOR_OFF "<" COLOR_BOLD "signature" COLOR_OFF "> - print a C function computing the expression, eg: --emit-c \"f(double x, long n)\"\n" \
+COLOR_BOLD "\t--compile " COLOR_OFF "<" COLOR_BOLD "file" COLOR_OFF "> - parse the expression once and write it to file for " COLOR_BOLD "--load" COLOR_OFF "\n" \
+COLOR_BOLD "\t--load " COLOR_OFF "<" COLOR_BOLD "file" COLOR_OFF "> - evaluate an expression written by " COLOR_BOLD "--compile" COLOR_OFF ", in place of <" COLOR_BOLD "expression" COLOR_OFF ">\n" \
+COLOR_BOLD "\t--follow " COLOR_OFF "<" COLOR_BOLD "file" COLOR_OFF "> - evaluate each line of file and each line appended to it, in place of <" COLOR_BOLD "expression" COLOR_OFF ">\n" \
+COLOR_BOLD "\t--pipeline" COLOR_OFF " - with " COLOR_BOLD "-" COLOR_OFF ", read, parse, evaluate and write on separate threads\n" \
+COLOR_BOLD "\t--pipeline-stats" COLOR_OFF " - like " COLOR_BOLD "--pipeline" COLOR_OFF ", and report the utilization of each stage\n" \
+COLOR_BOLD "\t--max-length " COLOR_OFF "<" COLOR_BOLD "n" COLOR_OFF "> - limit expressions to n characters (default: 16777216)\n" \
+COLOR_BOLD "\t--max-tokens " COLOR_OFF "<" COLOR_BOLD "n" COLOR_OFF "> - limit expressions to n tokens (default: 4194304)\n" \
+COLOR_BOLD "\t--max-nodes " COLOR_OFF "<" COLOR_BOLD "n" COLOR_OFF "> - limit expressions to n syntax tree nodes (default: 4194304)\n" \
+COLOR_BOLD "\t--max-depth " COLOR_OFF "<" COLOR_BOLD "n" COLOR_OFF "> - limit the nesting of parentheses and operators to n (default: 10000)\n" \
+COLOR_BOLD "\t--timeout " COLOR_OFF "<" COLOR_BOLD "ms" COLOR_OFF "> - stop evaluating after ms milliseconds (default: no limit)\n" \
+COLOR_BOLD "\t--max-memory " COLOR_OFF "<" COLOR_BOLD "bytes" COLOR_OFF "> - limit the memory used by arrays (default: no limit)\n" \
+"\t\tA limit of 0 means no limit.\n" \
 COLOR_BOLD "\nDESCRIPTION\n" COLOR_OFF \
 "\tCalculates and displays the result of the mathematical expression <" COLOR_BOLD "expression" COLOR_OFF ">.\n" \
 "\tInput operands can be whole numbers or decimal numbers. A single decimal number operand,\n" \
 "\tregardless of the number of whole number operands, will make the result a decimal\n" \
 "\tnumber.\n" \
-"\n\t<" COLOR_BOLD "expression" COLOR_OFF "> may contain spaces. If <" COLOR_BOLD "expression" COLOR_OFF "> contains characters \'/\' or \'*\', it\n" \
+"\n\tIf the only argument is " COLOR_BOLD "-" COLOR_OFF ", each line of standard input is evaluated as a separate\n" \
+"\texpression and one result is printed per line.\n" \
+"\n\tWith " COLOR_BOLD "--columns" COLOR_OFF ", each column of <" COLOR_BOLD "file" COLOR_OFF "> is bound to the variable of the same name and the\n" \
+"\tresults are written to standard output as a binary column file named result.\n" \
+"\n\tWith " COLOR_BOLD "--csv" COLOR_OFF ", " COLOR_BOLD "$1" COLOR_OFF ", " COLOR_BOLD "$2" COLOR_OFF ", ... refer to the fields of each row, and each row is written with\n" \
+"\tthe result appended. The result is empty if a referenced field is not a number.\n" \
+"\n\t<" COLOR_BOLD "expression" COLOR_OFF "> may contain spaces. If <" COLOR_BOLD "expression" COLOR_OFF "> contains characters such as \'/\', \'*\' or \'<\', it\n" \
 "\tmust be wrapped in double quotes (eg: "COLOR_BOLD"\""COLOR_OFF"<"COLOR_BOLD"expression"COLOR_OFF">"COLOR_BOLD"\""COLOR_OFF").\n" \
 "\n\tSupported operations are:" \
 "\n\t\t" COLOR_BOLD "+" COLOR_OFF " - addition" \
 "\n\t\t" COLOR_BOLD "-" COLOR_OFF " - subtraction" \
 "\n\t\t" COLOR_BOLD "*" COLOR_OFF " - multiplication" \
 "\n\t\t" COLOR_BOLD "/" COLOR_OFF " - division" \
-"\n\t\t" COLOR_BOLD "^" COLOR_OFF " - exponentiation\n" \
+"\n\t\t" COLOR_BOLD "^" COLOR_OFF " - exponentiation" \
+"\n\t\t" COLOR_BOLD "< <= > >= == !=" COLOR_OFF " - comparison, 1 if true and 0 if false" \
+"\n\t\t" COLOR_BOLD "and or" COLOR_OFF " - logical and, or; the right operand is only evaluated if needed" \
+"\n\t\t" COLOR_BOLD "c ? a : b" COLOR_OFF " - <" COLOR_BOLD "a" COLOR_OFF "> if <" COLOR_BOLD "c" COLOR_OFF "> is not 0, otherwise <" COLOR_BOLD "b" COLOR_OFF ">; only one branch is evaluated\n" \
+"\n\tSupported functions are:" \
+"\n\t\t" COLOR_BOLD "sqrt exp log sin cos tan" COLOR_OFF " - one argument, decimal result" \
+"\n\t\t" COLOR_BOLD "abs" COLOR_OFF " - absolute value" \
+"\n\t\t" COLOR_BOLD "min max" COLOR_OFF " - smaller or larger of two arguments" \
+"\n\t\t" COLOR_BOLD "dot matmul transpose" COLOR_OFF " - dot product, matrix product, transpose\n" \
+"\n\tArrays are written [1, 2, 3] for a vector and [[1, 2], [3, 4]] for a matrix. Operations" \
+"\n\tand functions apply element-wise, and a number is combined with every element.\n" \
+"\n\tSupported reductions are:" \
+"\n\t\t" COLOR_BOLD "sum product min max" COLOR_OFF "(" COLOR_BOLD "i" COLOR_OFF ", " COLOR_BOLD "a" COLOR_OFF ", " COLOR_BOLD "b" COLOR_OFF ", " COLOR_BOLD "body" COLOR_OFF ")" \
+" - combine <" COLOR_BOLD "body" COLOR_OFF "> for each whole number <" COLOR_BOLD "i" COLOR_OFF "> from <" COLOR_BOLD "a" COLOR_OFF "> to <" COLOR_BOLD "b" COLOR_OFF ">" \
+"\n\t\t" COLOR_BOLD "sum product min max" COLOR_OFF "(" COLOR_BOLD "array" COLOR_OFF ") - combine the elements of <" COLOR_BOLD "array" COLOR_OFF ">\n" \
+"\n\tSolving and integration:" \
+"\n\t\t" COLOR_BOLD "solve" COLOR_OFF "(" COLOR_BOLD "x" COLOR_OFF ", " COLOR_BOLD "a" COLOR_OFF ", " COLOR_BOLD "b" COLOR_OFF ", " COLOR_BOLD "f" COLOR_OFF ")" \
+" - a value of <" COLOR_BOLD "x" COLOR_OFF "> from <" COLOR_BOLD "a" COLOR_OFF "> to <" COLOR_BOLD "b" COLOR_OFF "> for which <" COLOR_BOLD "f" COLOR_OFF "> is 0" \
+"\n\t\t" COLOR_BOLD "integrate" COLOR_OFF "(" COLOR_BOLD "x" COLOR_OFF ", " COLOR_BOLD "a" COLOR_OFF ", " COLOR_BOLD "b" COLOR_OFF ", " COLOR_BOLD "f" COLOR_OFF "[, " COLOR_BOLD "tol" COLOR_OFF "])" \
+" - the integral of <" COLOR_BOLD "f" COLOR_OFF "> over <" COLOR_BOLD "x" COLOR_OFF "> from <" COLOR_BOLD "a" COLOR_OFF "> to <" COLOR_BOLD "b" COLOR_OFF ">, to a relative tolerance (default: 10^-10)\n" \
 COLOR_BOLD "\nEXAMPLES\n" COLOR_OFF \
-"\tmath 3+4\n\tmath 3 + 4\n\tmath 3*4\n\tmath \"3 * 4\"\n\tmath \"((-20 - 2) * 4.5) / 11)\"\n\n"
+"\tmath 3+4\n\tmath 3 + 4\n\tmath 3*4\n\tmath \"3 * 4\"\n\tmath \"((-20 - 2) * 4.5) / 11)\"\n" \
+"\tmath \"max(2, sqrt(10))\"\n\tmath \"sum(i, 1, 1000000, 1.0 / i^2)\"\n\tmath \"matmul([[1, 2], [3, 4]], [5, 6])\"\n" \
+"\tmath \"solve(x, 0, 2, x^2 - 2)\"\n\tmath \"integrate(x, 0, 1, 4 / (1 + x^2))\"\n\tmath --csv data.csv \"$2 * $3 - $1\"\n\n"
 
 /**
  * Test help with "-h"
@@ -127,10 +177,9 @@ static void test_case_6(struct TestCase *test_case, char *program_path)
  */
 static void test_case_7(struct TestCase *test_case, char *program_path)
 {
-    double ans = 6000.0 - 321.0 / 11;
     test_case->input_count = 1;
     test_case->input       = assemble_input(program_path, test_case->input_count, "6000.0 - 321.0 / 11");
-    sprintf(test_case->expected_output, "%lf\n", ans);
+    sprintf(test_case->expected_output, "5970.818181818182\n");
 }
 
 /**
@@ -199,10 +248,9 @@ static void test_case_12(struct TestCase *test_case, char *program_path)
  */
 static void test_case_13(struct TestCase *test_case, char *program_path)
 {
-    double ans = ((-20 - 2) / 2.5) + 14;
     test_case->input_count = 1;
     test_case->input       = assemble_input(program_path, test_case->input_count, "((-20 - 2) / 2.5) + 14");
-    sprintf(test_case->expected_output, "%lf\n", ans);
+    sprintf(test_case->expected_output, "5.199999999999999\n");
 }
 
 /**
@@ -211,10 +259,9 @@ static void test_case_13(struct TestCase *test_case, char *program_path)
  */
 static void test_case_14(struct TestCase *test_case, char *program_path)
 {
-    double ans = (2.5 * (-20 - 2)) + 14;
     test_case->input_count = 1;
     test_case->input       = assemble_input(program_path, test_case->input_count, "(2.5 * (-20 - 2)) + 14");
-    sprintf(test_case->expected_output, "%lf\n", ans);
+    sprintf(test_case->expected_output, "-41.0\n");
 }
 
 /**
@@ -223,11 +270,10 @@ static void test_case_14(struct TestCase *test_case, char *program_path)
  */
 static void test_case_15(struct TestCase *test_case, char *program_path)
 {
-    double ans = ((88 - 87) * 1.25 * (-2 - 2) - (3 + 4 * (69 - -200) * 0.01) * 10);
     test_case->input_count = 1;
     test_case->input       = assemble_input(program_path, test_case->input_count,
                                             "((88 - 87) * 1.25 * (-2 - 2) - (3 + 4 * (69 - -200) * 0.01) * 10)");
-    sprintf(test_case->expected_output, "%lf\n", ans);
+    sprintf(test_case->expected_output, "-142.6\n");
 }
 
 /**
@@ -274,6 +320,1267 @@ static void test_case_19(struct TestCase *test_case, char *program_path)
     sprintf(test_case->expected_output, "Incomplete expression. Use 'math -h' or 'math -help' for help.\n");
 }
 
+/**
+ * Test that small decimal results keep their precision.
+ * @param test_case the TestCase to load
+ */
+static void test_case_20(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "1 / 1000000000.0");
+    sprintf(test_case->expected_output, "1e-9\n");
+}
+
+/**
+ * Test that whole decimal results are still displayed as decimals.
+ * @param test_case the TestCase to load
+ */
+static void test_case_21(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "2.5 * 4");
+    sprintf(test_case->expected_output, "10.0\n");
+}
+
+/**
+ * Test a function call nested in an expression.
+ * @param test_case the TestCase to load
+ */
+static void test_case_22(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "sqrt(16) * (1 + exp(0))");
+    sprintf(test_case->expected_output, "8.0\n");
+}
+
+/**
+ * Test that whole number functions of whole numbers have whole number results.
+ * @param test_case the TestCase to load
+ */
+static void test_case_23(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "max(3, min(9, 7))-abs(-2)");
+    sprintf(test_case->expected_output, "5\n");
+}
+
+/**
+ * Test an unknown function.
+ * @param test_case the TestCase to load
+ */
+static void test_case_24(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "foo(2)");
+    sprintf(test_case->expected_output, "Unknown function in expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a function call with the wrong number of arguments.
+ * @param test_case the TestCase to load
+ */
+static void test_case_25(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "max(1, 2, 3)");
+    sprintf(test_case->expected_output, "Function 'max' takes 1, 2 or 4 arguments. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a whole number sum over an index range.
+ * @param test_case the TestCase to load
+ */
+static void test_case_26(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "sum(i, 1, 100, i) - product(j, 1, 5, j)");
+    sprintf(test_case->expected_output, "4930\n");
+}
+
+/**
+ * Test a compensated decimal sum on one thread.
+ * @param test_case the TestCase to load
+ */
+static void test_case_27(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--threads", "1",
+                                            "sum(i, 1, 1000000, 1.0 / (i * i))");
+    sprintf(test_case->expected_output, "1.6449330668487265\n");
+}
+
+/**
+ * Test that a decimal sum on several threads matches the sum on one thread.
+ * @param test_case the TestCase to load
+ */
+static void test_case_28(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--threads", "7",
+                                            "sum(i, 1, 1000000, 1.0 / (i * i))");
+    sprintf(test_case->expected_output, "1.6449330668487265\n");
+}
+
+/**
+ * Test a variable used outside of the reduction that binds it.
+ * @param test_case the TestCase to load
+ */
+static void test_case_29(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "max(i, 1, 3, i) + i");
+    sprintf(test_case->expected_output, "Unknown variable 'i' in expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that a reduction body with function calls gives the same result as the plain expression.
+ * @param test_case the TestCase to load
+ */
+static void test_case_30(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "sum(i, 17, 17, sin(i) * tan(i))");
+    sprintf(test_case->expected_output, "-3.359041738398254\n");
+}
+
+/**
+ * Test a bound of a reduction that uses its own index variable.
+ * @param test_case the TestCase to load
+ */
+static void test_case_31(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "sum(i, 1, i, i)");
+    sprintf(test_case->expected_output, "Bounds of 'sum' cannot use its variable 'i'. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a whole number sum that does not fit in a long.
+ * @param test_case the TestCase to load
+ */
+static void test_case_32(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "sum(i, 1, 3, 2^62)");
+    sprintf(test_case->expected_output, "Result of a reduction does not fit in a whole number. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a whole number product that does not fit in a long.
+ * @param test_case the TestCase to load
+ */
+static void test_case_33(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "product(i, 1, 21, i)");
+    sprintf(test_case->expected_output, "Result of a reduction does not fit in a whole number. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a product whose whole number terms overflow a long, with a decimal term.
+ * @param test_case the TestCase to load
+ */
+static void test_case_34(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "product(i, 1, 25, i + sum(j, 25, i, 0.0))");
+    sprintf(test_case->expected_output, "1.5511210043330986e25\n");
+}
+
+/**
+ * Test comparisons of whole and decimal numbers.
+ * @param test_case the TestCase to load
+ */
+static void test_case_35(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "(3 < 4) + (2 >= 2.5) + (1 == 1.0)");
+    sprintf(test_case->expected_output, "2\n");
+}
+
+/**
+ * Test that the untaken branch of a conditional is not evaluated. Dividing by zero would crash.
+ * @param test_case the TestCase to load
+ */
+static void test_case_36(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "2 > 1 ? 7 : 1 / 0");
+    sprintf(test_case->expected_output, "7\n");
+}
+
+/**
+ * Test that and and or only evaluate their right operand when needed.
+ * @param test_case the TestCase to load
+ */
+static void test_case_37(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "(0 and 1 / 0) + (1 or 1 / 0)");
+    sprintf(test_case->expected_output, "1\n");
+}
+
+/**
+ * Test a conditional without a ':'.
+ * @param test_case the TestCase to load
+ */
+static void test_case_38(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "(1 ? 2) + 3");
+    sprintf(test_case->expected_output, "Unmatched '?' in expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test element-wise array operations with a number.
+ * @param test_case the TestCase to load
+ */
+static void test_case_39(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "[1, 2, 3] * 2 + [0.5, 0.5, 0.5]");
+    sprintf(test_case->expected_output, "[2.5, 4.5, 6.5]\n");
+}
+
+/**
+ * Test matrix product with a vector.
+ * @param test_case the TestCase to load
+ */
+static void test_case_40(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "matmul([[1, 2], [3, 4]], [5, 6])");
+    sprintf(test_case->expected_output, "[17.0, 39.0]\n");
+}
+
+/**
+ * Test transpose, dot and reduction of an array.
+ * @param test_case the TestCase to load
+ */
+static void test_case_41(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "dot([1, 2, 3], [4, 5, 6]) + sum(transpose([[1, 2], [3, 4]]))");
+    sprintf(test_case->expected_output, "42.0\n");
+}
+
+/**
+ * Test functions applied element-wise.
+ * @param test_case the TestCase to load
+ */
+static void test_case_42(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "max(sqrt([4, 9]), [1, 5])");
+    sprintf(test_case->expected_output, "[2.0, 5.0]\n");
+}
+
+/**
+ * Test arrays of different shapes.
+ * @param test_case the TestCase to load
+ */
+static void test_case_43(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "[1, 2] + [[1, 2], [3, 4]]");
+    sprintf(test_case->expected_output, "Array shapes do not match. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test column mode with a missing column file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_44(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--columns", "/nonexistent/data.col", "x + 1");
+    sprintf(test_case->expected_output, "Could not read column file. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test column mode with an empty column file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_45(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--columns", "/dev/null", "x + 1");
+    sprintf(test_case->expected_output, "Invalid column file header. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test column mode without a file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_46(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--columns");
+    sprintf(test_case->expected_output, "Option '--columns' requires a file, or '-' for standard input. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test column mode on a column file of whole numbers and decimals, with a whole number result.
+ * @param test_case the TestCase to load
+ */
+static void test_case_47(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "\"$0\" --columns test/data.col \"x * 2 - 1\" | od -An -v -td8 -w8 -j32 | tr -d ' '",
+                                            program_path);
+    sprintf(test_case->expected_output, "1\n3\n5\n");
+}
+
+/**
+ * Test column mode on standard input, with a decimal result.
+ * @param test_case the TestCase to load
+ */
+static void test_case_48(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "\"$0\" --columns - \"x * y + 1\" < test/data.col | od -An -v -tf8 -w8 -j32 | tr -d ' '",
+                                            program_path);
+    sprintf(test_case->expected_output, "1.5\n4\n8.5\n");
+}
+
+/**
+ * Test a column reference outside CSV mode.
+ * @param test_case the TestCase to load
+ */
+static void test_case_49(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "$1 + 1");
+    sprintf(test_case->expected_output, "Unknown variable '$1' in expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test CSV mode with a missing file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_50(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--csv", "/nonexistent/data.csv", "$2 * $3 - $1");
+    sprintf(test_case->expected_output, "Could not read CSV file. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test CSV mode with a reference to field 0.
+ * @param test_case the TestCase to load
+ */
+static void test_case_51(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--csv", "/dev/null", "$0 + 1");
+    sprintf(test_case->expected_output, "Fields are numbered from $1. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test CSV mode on a CSV file with a header, a quoted field, a field that is not a number and a blank line.
+ * @param test_case the TestCase to load
+ */
+static void test_case_52(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--csv", "test/data.csv", "$2 * $3");
+    sprintf(test_case->expected_output, "name,price,qty,\nwidget,2.5,4,10.0\n\"bolt, small\",0.1,3,0.30000000000000004\ngadget,x,2,\nnut,7,6,42\n");
+}
+
+/**
+ * Test CSV mode on standard input.
+ * @param test_case the TestCase to load
+ */
+static void test_case_53(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c", "\"$0\" --csv - '$3 - 1' < test/data.csv",
+                                            program_path);
+    sprintf(test_case->expected_output, "name,price,qty,\nwidget,2.5,4,3\n\"bolt, small\",0.1,3,2\ngadget,x,2,1\nnut,7,6,5\n");
+}
+
+/**
+ * Test a CSV field number too large to be read.
+ * @param test_case the TestCase to load
+ */
+static void test_case_54(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--csv", "test/data.csv",
+                                            "$99999999999999999999 + 1");
+    sprintf(test_case->expected_output, "Field '$99999999999999999999' is beyond the limit of 65536 fields. "
+                                        "Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a CSV field number above the limit.
+ * @param test_case the TestCase to load
+ */
+static void test_case_55(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--csv", "test/data.csv", "$65537");
+    sprintf(test_case->expected_output, "Field '$65537' is beyond the limit of 65536 fields. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test the expression length limit.
+ * @param test_case the TestCase to load
+ */
+static void test_case_56(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--max-length", "4", "1+2+3");
+    sprintf(test_case->expected_output, "Expression is longer than the limit of 4 characters. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test the token limit.
+ * @param test_case the TestCase to load
+ */
+static void test_case_57(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--max-tokens", "4", "1 + 2 + 3");
+    sprintf(test_case->expected_output, "Expression has more than the limit of 4 tokens. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test the depth limit with a chain of operators.
+ * @param test_case the TestCase to load
+ */
+static void test_case_58(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--max-depth", "2", "2 ^ 2 ^ 2 ^ 2");
+    sprintf(test_case->expected_output, "Expression is nested deeper than the limit of 2. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test the time limit on a long reduction.
+ * @param test_case the TestCase to load
+ */
+static void test_case_59(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--timeout", "50", "sum(i, 1, 100000000000, i)");
+    sprintf(test_case->expected_output, "Evaluation exceeded the time limit set by --timeout. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test the memory limit on arrays.
+ * @param test_case the TestCase to load
+ */
+static void test_case_60(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--max-memory", "64", "[1, 2, 3, 4, 5, 6, 7, 8, 9, 10]");
+    sprintf(test_case->expected_output, "Evaluation exceeded the memory limit set by --max-memory. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a reduction body nested as deep as the default limit, evaluated by several threads.
+ * @param test_case the TestCase to load
+ */
+static void test_case_61(struct TestCase *test_case, char *program_path)
+{
+    static char expression[1 << 15];
+    size_t      len = 0;
+    len += (size_t) sprintf(expression, "sum(i, 1, 100000, ");
+    for (int i = 0; i < 5000; ++i) // Each level adds an operator and a parenthesis.
+    {
+        memcpy(expression + len, "i+(", 3);
+        len += 3;
+    }
+    expression[len++] = 'i';
+    memset(expression + len, ')', 5001);
+    expression[len + 5001] = '\0';
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--threads", "4", expression);
+    sprintf(test_case->expected_output, "25005250050000\n");
+}
+
+/**
+ * Test a reduction body nested one level deeper than the default limit.
+ * @param test_case the TestCase to load
+ */
+static void test_case_62(struct TestCase *test_case, char *program_path)
+{
+    static char expression[1 << 15];
+    size_t      len = 0;
+    len += (size_t) sprintf(expression, "sum(i, 1, 10, ");
+    for (int i = 0; i < 5001; ++i)
+    {
+        memcpy(expression + len, "i+(", 3);
+        len += 3;
+    }
+    expression[len++] = 'i';
+    memset(expression + len, ')', 5002);
+    expression[len + 5002] = '\0';
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, expression);
+    sprintf(test_case->expected_output, "Expression is nested deeper than the limit of 10000. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test --pipeline on expressions read from standard input, including a blank line and an error.
+ * @param test_case the TestCase to load
+ */
+static void test_case_63(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "printf '1 + 2 * 3\\n\\n2 ^ 10\\n10 / 4.0\\n1 +\\n' | \"$0\" --pipeline -",
+                                            program_path);
+    sprintf(test_case->expected_output, "7\n1024\n2.5\nIncomplete expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test --pipeline with an expression in place of '-'.
+ * @param test_case the TestCase to load
+ */
+static void test_case_64(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 2;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--pipeline", "1 + 2 * 3");
+    sprintf(test_case->expected_output, "Option '--pipeline' requires '-' in place of the expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test solve with Halley's method.
+ * @param test_case the TestCase to load
+ */
+static void test_case_65(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "solve(x, 0, 2, x^2 - 2)");
+    sprintf(test_case->expected_output, "1.4142135623730951\n");
+}
+
+/**
+ * Test solve through a function call.
+ * @param test_case the TestCase to load
+ */
+static void test_case_66(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "solve(x, 0, 1, cos(x) - x)");
+    sprintf(test_case->expected_output, "0.7390851332151607\n");
+}
+
+/**
+ * Test solve through a reduction.
+ * @param test_case the TestCase to load
+ */
+static void test_case_67(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "solve(r, 0.001, 1, sum(k, 1, 30, 100 / (1 + r)^k) - 2000)");
+    sprintf(test_case->expected_output, "0.02844635769194371\n");
+}
+
+/**
+ * Test solve without a root between its bounds.
+ * @param test_case the TestCase to load
+ */
+static void test_case_68(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "solve(x, 1, 3, x^2)");
+    sprintf(test_case->expected_output, "No root found by 'solve' between its bounds. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test solve with the wrong number of arguments.
+ * @param test_case the TestCase to load
+ */
+static void test_case_69(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "solve(x, 1, 3)");
+    sprintf(test_case->expected_output, "Function 'solve' takes 4 arguments. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test solve across a pole, where f changes sign without a root.
+ * @param test_case the TestCase to load
+ */
+static void test_case_70(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "solve(x, -5, 5, 1 / x)");
+    sprintf(test_case->expected_output, "No root found by 'solve' between its bounds. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test integrate with Gauss-Kronrod quadrature.
+ * @param test_case the TestCase to load
+ */
+static void test_case_71(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "integrate(x, 0, 1, 4 / (1 + x^2))");
+    sprintf(test_case->expected_output, "3.141592653589794\n");
+}
+
+/**
+ * Test integrate over a discontinuity, with reversed bounds.
+ * @param test_case the TestCase to load
+ */
+static void test_case_72(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "integrate(x, 2, 0, x > 1 ? 1 : 0)");
+    sprintf(test_case->expected_output, "-1.0\n");
+}
+
+/**
+ * Test integrate with a tolerance.
+ * @param test_case the TestCase to load
+ */
+static void test_case_73(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "integrate(x, 0, 1, 1 / sqrt(x), 0.000001)");
+    sprintf(test_case->expected_output, "1.9999999128753463\n");
+}
+
+/**
+ * Test integrate with a tolerance of 0.
+ * @param test_case the TestCase to load
+ */
+static void test_case_74(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "integrate(x, 0, 1, x, 0)");
+    sprintf(test_case->expected_output, "Tolerance of 'integrate' must be greater than 0. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test integrate with the wrong number of arguments.
+ * @param test_case the TestCase to load
+ */
+static void test_case_75(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "integrate(x, 0, 1)");
+    sprintf(test_case->expected_output, "Function 'integrate' takes 4 or 5 arguments. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test integrate over a pole, where the integrand is not finite.
+ * @param test_case the TestCase to load
+ */
+static void test_case_76(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "integrate(x, -1, 1, 1 / x)");
+    sprintf(test_case->expected_output, "Integrand of 'integrate' is not finite between its bounds. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test an empty definitions file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_77(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--defs", "/dev/null", "2 * 3");
+    sprintf(test_case->expected_output, "6\n");
+}
+
+/**
+ * Test a missing definitions file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_78(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--defs", "/nonexistent/defs", "1");
+    sprintf(test_case->expected_output, "Could not read definitions file. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test --defs without a file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_79(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--defs");
+    sprintf(test_case->expected_output, "Option '--defs' requires a file. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test inlining functions from a definitions file that call each other.
+ * @param test_case the TestCase to load
+ */
+static void test_case_80(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--defs", "test/functions.defs", "hyp(3, 4) + twice(k())");
+    sprintf(test_case->expected_output, "11.0\n");
+}
+
+/**
+ * Test that the index variable of a reduction in a function does not capture the caller's variable.
+ * @param test_case the TestCase to load
+ */
+static void test_case_81(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--defs", "test/functions.defs", "sum(i, 1, 2, shift(i))");
+    sprintf(test_case->expected_output, "21\n");
+}
+
+/**
+ * Test that fixed-point decimals are exact.
+ * @param test_case the TestCase to load
+ */
+static void test_case_82(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "0.1 + 0.2 == 0.3");
+    sprintf(test_case->expected_output, "1\n");
+}
+
+/**
+ * Test that whole number division is rounded, not truncated, in decimal mode.
+ * @param test_case the TestCase to load
+ */
+static void test_case_83(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "10 / 4 + 2 / 3");
+    sprintf(test_case->expected_output, "3.17\n");
+}
+
+/**
+ * Test that products are rounded half to even by default.
+ * @param test_case the TestCase to load
+ */
+static void test_case_84(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "1.10 * 2.35");
+    sprintf(test_case->expected_output, "2.58\n");
+}
+
+/**
+ * Test a rounding mode.
+ * @param test_case the TestCase to load
+ */
+static void test_case_85(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 5;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "--rounding",
+                                            "half-up", "1.10 * 2.35");
+    sprintf(test_case->expected_output, "2.59\n");
+}
+
+/**
+ * Test a fixed-point sum on several threads.
+ * @param test_case the TestCase to load
+ */
+static void test_case_86(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2",
+                                            "sum(i, 1, 1000000, i * 0.01)");
+    sprintf(test_case->expected_output, "5000005000.00\n");
+}
+
+/**
+ * Test fixed-point overflow.
+ * @param test_case the TestCase to load
+ */
+static void test_case_87(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "1.1 ^ 1000");
+    sprintf(test_case->expected_output, "Result cannot be represented as a fixed-point decimal. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test an invalid scale.
+ * @param test_case the TestCase to load
+ */
+static void test_case_88(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "19", "1");
+    sprintf(test_case->expected_output, "Option '--decimal' requires a number of digits from 0 to 18. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test CSV mode with fixed-point decimals.
+ * @param test_case the TestCase to load
+ */
+static void test_case_89(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 5;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "--csv", "test/data.csv", "$2 * $3");
+    sprintf(test_case->expected_output, "name,price,qty,\nwidget,2.5,4,10.00\n\"bolt, small\",0.1,3,0.30\ngadget,x,2,\nnut,7,6,42\n");
+}
+
+/**
+ * Test that products rounded in a block of a fixed-point sum follow the rounding mode.
+ * @param test_case the TestCase to load
+ */
+static void test_case_90(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 5;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "--rounding",
+                                            "half-up", "sum(i, 1, 1000, i * 0.25 * 0.10)");
+    sprintf(test_case->expected_output, "12515.00\n");
+}
+
+/**
+ * Test that arrays cannot be used with fixed-point decimals.
+ * @param test_case the TestCase to load
+ */
+static void test_case_91(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "sum([0.1, 0.2])");
+    sprintf(test_case->expected_output, "Arrays cannot be used with --decimal, as they hold binary floating point numbers. "
+                                         "Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a negative fixed-point literal with all 18 digits of the scale.
+ * @param test_case the TestCase to load
+ */
+static void test_case_92(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "18", "0 - -1.123456789012345678");
+    sprintf(test_case->expected_output, "1.123456789012345678\n");
+}
+
+/**
+ * Test that a literal longer than a long has digits is read whole and rounded by the rounding mode.
+ * @param test_case the TestCase to load
+ */
+static void test_case_93(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2",
+                                            "1.12500000000000000000000000000000000000000001");
+    sprintf(test_case->expected_output, "1.13\n");
+}
+
+/**
+ * Test that a long literal that does not fit is quoted whole in the error.
+ * @param test_case the TestCase to load
+ */
+static void test_case_94(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--decimal", "2", "123456789012345678.25");
+    sprintf(test_case->expected_output, "Number '123456789012345678.25' cannot be represented as a fixed-point decimal. "
+                                        "Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Write a balanced sum of 2^depth leaves, taken in turn from 0.1, 0.7 and 3.3.
+ * @param out where to write the sum
+ * @param end the end of the buffer at out
+ * @param depth the depth of the sum
+ * @param leaf the number of leaves written so far
+ * @return the end of the written sum
+ */
+static char *write_balanced_sum(char *out, char *end, int depth, int *leaf)
+{
+    static const char *leaves[] = {"0.1", "0.7", "3.3"};
+    
+    if (depth == 0)
+    {
+        return out + snprintf(out, (size_t) (end - out), "%s", leaves[(*leaf)++ % 3]);
+    }
+    out += snprintf(out, (size_t) (end - out), "(");
+    out  = write_balanced_sum(out, end, depth - 1, leaf);
+    out += snprintf(out, (size_t) (end - out), "+");
+    out  = write_balanced_sum(out, end, depth - 1, leaf);
+    return out + snprintf(out, (size_t) (end - out), ")");
+}
+
+/**
+ * Test that a large expression evaluated by several threads gives the serial result. The sum of
+ * its leaves depends on the order of addition: added left to right, it is 22390.199999998895.
+ * @param test_case the TestCase to load
+ */
+static void test_case_95(struct TestCase *test_case, char *program_path)
+{
+    static char expression[1 << 17];
+    int         leaf = 0;
+    write_balanced_sum(expression, expression + sizeof(expression), 14, &leaf); // 16384 leaves, so the top levels are split.
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--threads", "4", expression);
+    sprintf(test_case->expected_output, "22390.2\n");
+}
+
+/**
+ * Test definitions called with constant expressions on several threads, where the arguments are
+ * folded before the tree is marked for forks.
+ * @param test_case the TestCase to load
+ */
+static void test_case_96(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 5;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--threads", "2", "--defs",
+                                            "test/functions.defs", "twice(2 + 3) + sq(1 + 2)");
+    sprintf(test_case->expected_output, "19\n");
+}
+
+/**
+ * Test emitting a C function with a whole number and a decimal parameter.
+ * @param test_case the TestCase to load
+ */
+static void test_case_97(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--emit-c", "f(double x, long n)", "x * 2 + n / 2 + max(n, 1)");
+    sprintf(test_case->expected_output, "/*\n * f, generated by math --emit-c. Compile without floating-point contraction,\n"
+                                        " * eg: -ffp-contract=off, for results identical to math.\n */\n"
+                                        "#include <math.h>\n#include <stdlib.h>\n\n"
+                                        "static inline long f_lmax(long a, long b)\n{\n    return a > b ? a : b;\n}\n\n"
+                                        "static inline double f(double x, long n)\n{\n    return (((x * 2L) + (n / 2L)) + f_lmax(n, 1L));\n}\n");
+}
+
+/**
+ * Test an invalid --emit-c signature.
+ * @param test_case the TestCase to load
+ */
+static void test_case_98(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--emit-c", "f(float x)", "x");
+    sprintf(test_case->expected_output, "Invalid signature for '--emit-c', eg: f(double x, long n). Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that a reduction is not emitted.
+ * @param test_case the TestCase to load
+ */
+static void test_case_99(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--emit-c", "f(long n)", "sum(i, 1, n, i)");
+    sprintf(test_case->expected_output, "Function 'sum' cannot be emitted as C. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that inlined calls fold constant operations and bind an argument used twice with a let.
+ * @param test_case the TestCase to load
+ */
+static void test_case_100(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 5;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--defs", "test/functions.defs", "--emit-c", "f(long x)",
+                                            "sq(3) * x + twice(x * 2) + k()");
+    sprintf(test_case->expected_output, "/*\n * f, generated by math --emit-c. Compile without floating-point contraction,\n"
+                                        " * eg: -ffp-contract=off, for results identical to math.\n */\n"
+                                        "#include <math.h>\n#include <stdlib.h>\n\n"
+                                        "static inline long f_let0(long x, long f_v6)\n{\n    return (f_v6 + f_v6);\n}\n\n"
+                                        "static inline long f(long x)\n{\n    return (((9L * x) + f_let0(x, (x * 2L))) + 3L);\n}\n");
+}
+
+/**
+ * Test emitting a C function named as a function the emitted code calls.
+ * @param test_case the TestCase to load
+ */
+static void test_case_101(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--emit-c", "sqrt(double x)", "sqrt(x)");
+    sprintf(test_case->expected_output, "Invalid signature for '--emit-c', eg: f(double x, long n). Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test emitting a C function named as a C keyword.
+ * @param test_case the TestCase to load
+ */
+static void test_case_102(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--emit-c", "return(long n)", "n + 1");
+    sprintf(test_case->expected_output, "Invalid signature for '--emit-c', eg: f(double x, long n). Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a whole number polynomial evaluated in Horner form.
+ * @param test_case the TestCase to load
+ */
+static void test_case_103(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 1;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "sum(i, 1, 1000, 3*i^4 + 2*i^3 - i + 7)");
+    sprintf(test_case->expected_output, "602002000006400\n");
+}
+
+/**
+ * Test the Horner form of a polynomial with terms of the same degree and a missing degree.
+ * @param test_case the TestCase to load
+ */
+static void test_case_104(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--emit-c", "p(double x)", "x^3*2.5 - 3 + 2*x - x^3");
+    sprintf(test_case->expected_output, "/*\n * p, generated by math --emit-c. Compile without floating-point contraction,\n"
+                                        " * eg: -ffp-contract=off, for results identical to math.\n */\n"
+                                        "#include <math.h>\n#include <stdlib.h>\n\n"
+                                        "static inline double p(double x)\n{\n    return (((((1.5 * x) * x) + 2L) * x) + (-3L));\n}\n");
+}
+
+/**
+ * Test compiling an expression to a file that cannot be written.
+ * @param test_case the TestCase to load
+ */
+static void test_case_105(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--compile", "/nonexistent/expr.bin", "sum(i, 1, 10, i^2)");
+    sprintf(test_case->expected_output, "Cannot write compiled expression file '/nonexistent/expr.bin'. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test loading a file that is not a compiled expression.
+ * @param test_case the TestCase to load
+ */
+static void test_case_106(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 2;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--load", "/dev/null");
+    sprintf(test_case->expected_output, "Invalid compiled expression file. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test loading a missing compiled expression file.
+ * @param test_case the TestCase to load
+ */
+static void test_case_107(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 2;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--load", "/nonexistent/expr.bin");
+    sprintf(test_case->expected_output, "Cannot read compiled expression file '/nonexistent/expr.bin'. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test --load with an expression.
+ * @param test_case the TestCase to load
+ */
+static void test_case_108(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--load", "/dev/null", "1 + 2");
+    sprintf(test_case->expected_output, "Option '--load' takes the place of the expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test compiling an expression to a file and evaluating it with --load.
+ * @param test_case the TestCase to load
+ */
+static void test_case_109(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "f=$(mktemp) && \"$0\" --compile \"$f\" \"sum(i, 1, 10, i^2) + max(3, 4) * 2.5\" && "
+                                            "\"$0\" --load \"$f\"; rm -f \"$f\"",
+                                            program_path);
+    sprintf(test_case->expected_output, "395.0\n");
+}
+
+/**
+ * Test that a loaded expression is checked against the depth limit.
+ * @param test_case the TestCase to load
+ */
+static void test_case_110(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "f=$(mktemp) && \"$0\" --compile \"$f\" \"sum(i, 1, 10, i^2) + max(3, 4) * 2.5\" && "
+                                            "\"$0\" --max-depth 3 --load \"$f\"; rm -f \"$f\"",
+                                            program_path);
+    sprintf(test_case->expected_output, "Expression is nested deeper than the limit of 3. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that a compiled file with a colon outside a conditional is reported as invalid. The root
+ * of "1 + 2" is patched from an addition to a colon.
+ * @param test_case the TestCase to load
+ */
+static void test_case_111(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "f=$(mktemp) && \"$0\" --compile \"$f\" \"1 + 2\" && "
+                                            "printf '\\033' | dd of=\"$f\" bs=1 seek=48 conv=notrunc 2>/dev/null && "
+                                            "\"$0\" --load \"$f\"; rm -f \"$f\"",
+                                            program_path);
+    sprintf(test_case->expected_output, "Invalid compiled expression file. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test modular arithmetic with an exact exponent and a division by an inverse.
+ * @param test_case the TestCase to load
+ */
+static void test_case_112(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--mod", "1000000007", "7^(10^18) + 10 / 3");
+    sprintf(test_case->expected_output, "592950068\n");
+}
+
+/**
+ * Test a division by a number with no inverse modulo the modulus.
+ * @param test_case the TestCase to load
+ */
+static void test_case_113(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--mod", "6", "1 / 2");
+    sprintf(test_case->expected_output, "Divisor has no inverse modulo the modulus. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test a modulus that is too small.
+ * @param test_case the TestCase to load
+ */
+static void test_case_114(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--mod", "1", "2 + 3");
+    sprintf(test_case->expected_output, "Option '--mod' requires a modulus from 2 to 9223372036854775807. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that an exponent is computed exactly in modular mode, where a double would round it.
+ * @param test_case the TestCase to load
+ */
+static void test_case_115(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--mod", "1000000007", "7^(3^39)");
+    sprintf(test_case->expected_output, "121226682\n");
+}
+
+/**
+ * Test that an exponent that overflows in modular mode raises an error.
+ * @param test_case the TestCase to load
+ */
+static void test_case_116(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--mod", "1000000007", "7^(2^63)");
+    sprintf(test_case->expected_output, "Exponent or bound does not fit in a whole number in modular arithmetic. "
+                                        "Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that --fast-math computes exp of an array with its kernel: a single value is computed with
+ * libm, and the kernel results differ from it in the last bit, with or without FMA.
+ * @param test_case the TestCase to load
+ */
+static void test_case_117(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 2;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--fast-math",
+                                            "exp([0.283, 1.043]) - [exp(0.283), exp(1.043)]");
+    sprintf(test_case->expected_output, "[-2.220446049250313e-16, 4.440892098500626e-16]\n");
+}
+
+/**
+ * Test combining --fast-math with --decimal.
+ * @param test_case the TestCase to load
+ */
+static void test_case_118(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 4;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--fast-math", "--decimal", "2", "1 / 3");
+    sprintf(test_case->expected_output, "Options '--fast-math' and '--decimal' cannot be combined. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that --fast-math computes log of an array with its kernel.
+ * @param test_case the TestCase to load
+ */
+static void test_case_119(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 2;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--fast-math",
+                                            "log([0.023, 0.343]) - [log(0.023), log(0.343)]");
+    sprintf(test_case->expected_output, "[4.440892098500626e-16, 2.220446049250313e-16]\n");
+}
+
+/**
+ * Test that --fast-math reports its mode on standard error.
+ * @param test_case the TestCase to load
+ */
+static void test_case_120(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "\"$0\" --fast-math \"2 ^ 0.5\" 2>&1 >/dev/null | cut -d ' ' -f 1-6", program_path);
+    sprintf(test_case->expected_output, "fast-math: pow, exp and log kernels\n");
+}
+
+/**
+ * Test following a file that does not exist.
+ * @param test_case the TestCase to load
+ */
+static void test_case_121(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 2;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--follow", "/nonexistent/exprs.log");
+    sprintf(test_case->expected_output, "Cannot follow file '/nonexistent/exprs.log'. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test --follow with an expression.
+ * @param test_case the TestCase to load
+ */
+static void test_case_122(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input(program_path, test_case->input_count, "--follow", "/dev/null", "1 + 2");
+    sprintf(test_case->expected_output, "Option '--follow' takes the place of the expression. Use 'math -h' or 'math -help' for help.\n");
+}
+
+/**
+ * Test that --follow evaluates the lines already in a file. The file is a copy, so its offset file
+ * is left in a temporary directory.
+ * @param test_case the TestCase to load
+ */
+static void test_case_123(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "d=$(mktemp -d) && cp test/follow.txt \"$d/f\" && timeout 0.5 \"$0\" --follow \"$d/f\"; "
+                                            "rm -rf \"$d\"",
+                                            program_path);
+    sprintf(test_case->expected_output, "3\n1024\n2.5\n");
+}
+
+/**
+ * Test that --follow reads a new file created at its path after the file is renamed.
+ * @param test_case the TestCase to load
+ */
+static void test_case_124(struct TestCase *test_case, char *program_path)
+{
+    test_case->input_count = 3;
+    test_case->input       = assemble_input("/bin/sh", test_case->input_count, "-c",
+                                            "d=$(mktemp -d) && cp test/follow.txt \"$d/f\" || exit 1; \"$0\" --follow \"$d/f\" > \"$d/out\" & "
+                                            "p=$!; i=0; until [ \"$(wc -l < \"$d/out\")\" -ge 3 ] || [ $i -ge 100 ]; do sleep 0.05; i=$((i + 1)); done; "
+                                            "mv \"$d/f\" \"$d/f.1\"; printf '6 * 7\\n' > \"$d/f\"; "
+                                            "i=0; until [ \"$(wc -l < \"$d/out\")\" -ge 4 ] || [ $i -ge 100 ]; do sleep 0.05; i=$((i + 1)); done; "
+                                            "kill $p; cat \"$d/out\"; rm -rf \"$d\"",
+                                            program_path);
+    sprintf(test_case->expected_output, "3\n1024\n2.5\n42\n");
+}
+
 char **assemble_input(char *program_path, size_t num_args, ...)
 {
     char **input_array = malloc(sizeof(char *) * (num_args + 2));